@@ -26,6 +26,7 @@
 #include "classes.h"
 #include "extern.h"
 #include "funcdefs.h"
+#include "philox.h"
 
 // These are for the reductions used in device_len_dot and in device_max_inc/w.
 // The number of threads MUST be a power of two!
@@ -53,13 +54,15 @@ static float *fdata = NULL ;
 // already set on the device rather than having to use passed parameters.
 // The savings is probably small, but worthwhile.
 
-__constant__ int d_ncases ;        // Number of cases (needed for using shuffle_index as random sampler)
+__constant__ int d_ncases ;        // Number of cases
 __constant__ int d_n_inputs ;      // Number of inputs (size of visible, bottom layer)
 __constant__ int d_n_inputs_cols ; // Ditto, extended to multiple of 128 bytes
 __constant__ int d_nhid ;          // Number of hidden neurons
 __constant__ int d_nhid_cols ;     // Ditto, extended to multiple of 128 bytes
 __constant__ int d_mean_field ;    // Use mean field instead of random sampling?
 __constant__ int d_greedy_mean_field ;    // Use mean field for greedy training?
+__constant__ unsigned int d_rng_seed ;    // Random seed for this training run; see PHILOX.H
+__constant__ int d_rng_epoch ;            // Epoch, part of the random counter
 
 static       float *h_data = NULL ;
 __constant__ float *d_data ;
@@ -113,16 +116,16 @@ static cudaDeviceProp deviceProp ;
 // Function declarations
 
 __global__ void device_recon_error ( int nc ) ;
-__global__ void device_fetch_vis1 ( int istart , int random_offset ) ;
+__global__ void device_fetch_vis1 ( int istart ) ;
 __global__ void device_vis_to_hid ( int nc ) ;
-__global__ void device_hid_to_vis ( int nc , int random_offset ) ;
+__global__ void device_hid_to_vis ( int nc , int istart , int ichain ) ;
 __global__ void device_hid_to_vis_direct ( int nc ) ;
 __global__ void device_vis2_to_hid2 ( int nc ) ;
-__global__ void device_sample_hidden2 ( int nc , int random_offset ) ;
+__global__ void device_sample_hidden2 ( int nc , int istart , int ichain ) ;
 __global__ void device_len_dot () ;
 __global__ void device_max_inc ( int inc_vs_w ) ;
 __global__ void device_update_in_bias ( int nc , float rate , float momentum ) ;
-__global__ void device_update_hid_bias ( int nc , float rate , float momentum , int random_offset , float sparse_pen , float sparse_targ ) ;
+__global__ void device_update_hid_bias ( int nc , float rate , float momentum , int istart , float sparse_pen , float sparse_targ ) ;
 __global__ void device_update_weights ( int nc , float rate , float momentum , float weight_pen , float sparse_pen , float sparse_targ ) ;
 __global__ void device_transpose () ;
 
@@ -141,7 +144,7 @@ __global__ void device_transpose () ;
 
 
 int rbm_cuda_init (
-   int ncases ,            // Number of cases, needed for using shuffle_index for random sampling
+   int ncases ,            // Number of cases
    int ncols ,             // Number of columns in data (may exceed n_inputs)
    int n_inputs ,          // Number of inputs
    int nhid ,              // Number of hidden neurons
@@ -648,6 +651,36 @@ int cuda_shuffle_to_device (
 }
 
 
+/*
+--------------------------------------------------------------------------------
+
+   rng_epoch - Set the seed and epoch that key the random sampling
+
+--------------------------------------------------------------------------------
+*/
+
+
+int cuda_rng_epoch (
+   unsigned int seed ,     // Random seed for this training run
+   int epoch               // Epoch about to start
+   )
+{
+   char msg[256] ;
+   cudaError_t error_id ;
+
+   error_id = cudaMemcpyToSymbol ( d_rng_seed , &seed , sizeof(unsigned int) , 0 , cudaMemcpyHostToDevice ) ;
+   if (error_id  ==  cudaSuccess)
+      error_id = cudaMemcpyToSymbol ( d_rng_epoch , &epoch , sizeof(int) , 0 , cudaMemcpyHostToDevice ) ;
+
+   if (error_id  !=  cudaSuccess) {
+      sprintf_s ( msg , 255 , "CUDA bad rng_epoch %d: %s", error_id, cudaGetErrorString(error_id) ) ;
+      audit ( msg ) ;
+      return ERROR_CUDA_ERROR ;
+      }
+   return 0 ;
+}
+
+
 /*
 --------------------------------------------------------------------------------
 
@@ -846,15 +879,18 @@ int cuda_recon_error (
 
    If greedy_mean_field is false it then samples.
 
+   All sampling uses the counter-based generator in PHILOX.H, keyed by the
+   case's index in the dataset, so the draws are exactly those of the host
+   code in RBM_THR2.CPP.  Call cuda_rng_epoch() before each epoch.
+
 ------------------------------------------------------------------------------------------------
 */
 
 __global__ void device_fetch_vis1 (
-   int istart ,        // First case in this batch
-   int random_offset   // Starting index in shuffle_index for random sampling
+   int istart          // First case in this batch
    )
 {
-   int k, icase, ivis ;
+   int icase, ivis ;
    float frand ;
 
    ivis = blockIdx.x * blockDim.x + threadIdx.x ;
@@ -866,8 +902,7 @@ __global__ void device_fetch_vis1 (
    d_visible1[icase*d_n_inputs_cols+ivis] = d_data[d_shuffle_index[istart+icase]*d_n_inputs+ivis] ;
 
    if (! d_greedy_mean_field) {
-      k = ((unsigned int) (icase * d_n_inputs + ivis + random_offset)) % d_ncases ;
-      frand = (float) d_shuffle_index[k] / (float) d_ncases ;
+      frand = rng_uniform ( d_rng_seed , 0 , d_rng_epoch , d_shuffle_index[istart+icase] , RNG_VIS1 , ivis ) ;
       d_visible1[icase*d_n_inputs_cols+ivis] = (frand < d_visible1[icase*d_n_inputs_cols+ivis])  ?  1.0f : 0.0f ;
       }
 }
@@ -876,7 +911,6 @@ int cuda_fetch_vis1 (
    int istart ,           // First case in this batch
    int istop ,            // One past last case
    int n_inputs ,         // Number of inputs
-   int random_offset ,    // Starting index in shuffle_index for random sampling
    double *visible1       // If non-NULL, return n_inputs * (istop-istart) long
    )
 {
@@ -894,7 +928,7 @@ int cuda_fetch_vis1 (
    block_launch.y = istop - istart ;
    block_launch.z = 1 ;
 
-   device_fetch_vis1 <<< block_launch , threads_per_block >>> ( istart , random_offset ) ;   
+   device_fetch_vis1 <<< block_launch , threads_per_block >>> ( istart ) ;   
    cudaThreadSynchronize() ;
    error_id = cudaGetLastError () ;
    if (error_id != cudaSuccess) {
@@ -1029,10 +1063,11 @@ int cuda_vis_to_hid (
 
 __global__ void device_hid_to_vis (
    int nc ,                // Number of cases in this batch
-   int random_offset       // Starting index in shuffle_index for random sampling
+   int istart ,            // First case in this batch, for random sampling
+   int ichain              // Step in the Markov chain, for random sampling
    )
 {
-   int k, icase, ivis, ihid ;
+   int icase, ivis, ihid ;
    float sum, P, frand ;
 
    ivis = blockIdx.x * blockDim.x + threadIdx.x ;
@@ -1049,8 +1084,8 @@ __global__ void device_hid_to_vis (
    if (d_mean_field)
       d_visible2[icase*d_n_inputs_cols+ivis] = P ;
    else {
-      k = ((unsigned int) (icase * d_n_inputs + ivis + random_offset)) % d_ncases ;
-      frand = (float) d_shuffle_index[k] / (float) d_ncases ;
+      frand = rng_uniform ( d_rng_seed , 0 , d_rng_epoch , d_shuffle_index[istart+icase] ,
+                            RNG_PHASE ( RNG_VIS2 , ichain ) , ivis ) ;
       d_visible2[icase*d_n_inputs_cols+ivis] = (frand < P)  ?  1.0f : 0.0f ;
       }
 
@@ -1059,7 +1094,8 @@ __global__ void device_hid_to_vis (
 int cuda_hid_to_vis (
    int nc ,                // Number of cases in this batch
    int n_inputs ,          // Number of inputs
-   int random_offset ,     // Starting index in shuffle_index for random sampling
+   int istart ,            // First case in this batch, for random sampling
+   int ichain ,            // Step in the Markov chain, for random sampling
    double *visible2        // Work vector n_inputs * nc long
    )
 {
@@ -1078,7 +1114,7 @@ int cuda_hid_to_vis (
    block_launch.y = nc ;
    block_launch.z = 1 ;
 
-   device_hid_to_vis <<< block_launch , threads_per_block >>> ( nc , random_offset ) ;   
+   device_hid_to_vis <<< block_launch , threads_per_block >>> ( nc , istart , ichain ) ;   
    cudaThreadSynchronize() ;
    error_id = cudaGetLastError () ;
    if (error_id != cudaSuccess) {
@@ -1239,10 +1275,11 @@ int cuda_vis2_to_hid2 (
 
 __global__ void device_sample_hidden2 (
    int nc ,                // Number of cases in this batch
-   int random_offset       // Starting index in shuffle_index for random sampling
+   int istart ,            // First case in this batch, for random sampling
+   int ichain              // Step in the Markov chain, for random sampling
    )
 {
-   int k, icase, ihid ;
+   int icase, ihid ;
    float frand ;
 
    ihid = blockIdx.x * blockDim.x + threadIdx.x ;
@@ -1251,8 +1288,8 @@ __global__ void device_sample_hidden2 (
 
    icase = blockIdx.y ;
 
-   k = ((unsigned int) (icase * d_nhid + ihid + random_offset)) % d_ncases ;
-   frand = (float) d_shuffle_index[k] / (float) d_ncases ;
+   frand = rng_uniform ( d_rng_seed , 0 , d_rng_epoch , d_shuffle_index[istart+icase] ,
+                         RNG_PHASE ( RNG_HID , ichain ) , ihid ) ;
 
    d_hidden_act[icase*d_nhid_cols+ihid] = (frand < d_hidden2[icase*d_nhid_cols+ihid])  ?  1.0f : 0.0f ;
 }
@@ -1260,7 +1297,8 @@ __global__ void device_sample_hidden2 (
 int cuda_sample_hidden2 (
    int nc ,                // Number of cases in this batch
    int nhid ,              // Number of hidden neurons
-   int random_offset ,     // Starting index in shuffle_index for random sampling
+   int istart ,            // First case in this batch, for random sampling
+   int ichain ,            // Step in the Markov chain, for random sampling
    double *hidden_act      // Work vector nhid * (istop-istart) long
    )
 {
@@ -1276,7 +1314,7 @@ int cuda_sample_hidden2 (
    block_launch.y = nc ;
    block_launch.z = 1 ;
 
-   device_sample_hidden2 <<< block_launch , threads_per_block >>> ( nc , random_offset ) ;   
+   device_sample_hidden2 <<< block_launch , threads_per_block >>> ( nc , istart , ichain ) ;   
    cudaThreadSynchronize() ;
    error_id = cudaGetLastError () ;
    if (error_id != cudaSuccess) {
@@ -1583,12 +1621,12 @@ __global__ void device_update_hid_bias (
    int nc ,               // Number of cases in this batch
    float rate ,           // Learning rate
    float momentum ,       // Learning momentum
-   int random_offset ,    // Starting index in shuffle_index for random sampling hidden1 if not mean_field
+   int istart ,           // First case in this batch, for random sampling hidden1 if not mean_field
    float sparse_pen ,     // Sparsity penalty
    float sparse_targ      // Sparsity target
    )
 {
-   int icase, ihid, k ;
+   int icase, ihid ;
    float sum, frac_on, frand ;
 
    ihid = blockIdx.x * blockDim.x + threadIdx.x ;
@@ -1605,8 +1643,7 @@ __global__ void device_update_hid_bias (
       }
    else {
       for (icase=0 ; icase<nc ; icase++) {
-         k = ((unsigned int) (icase * d_nhid + ihid + random_offset)) % d_ncases ;
-         frand = (float) d_shuffle_index[k] / (float) d_ncases ;
+         frand = rng_uniform ( d_rng_seed , 0 , d_rng_epoch , d_shuffle_index[istart+icase] , RNG_HID1 , ihid ) ;
          d_hidden_act[icase*d_nhid_cols+ihid] = (frand < d_hidden1[icase*d_nhid_cols+ihid])  ?  1.0f : 0.0f ;
          sum += d_hidden_act[icase*d_nhid_cols+ihid] - d_hidden2[icase*d_nhid_cols+ihid] ;
          frac_on += d_hid_on_frac[icase*d_nhid_cols+ihid] ;
@@ -1632,7 +1669,7 @@ int cuda_update_hid_bias (
    int nhid ,              // Number of hidden neurons
    double rate ,           // Learning rate
    double momentum ,       // Learning momentum
-   int random_offset ,     // Starting index in shuffle_index for random sampling hidden1 if not mean_field
+   int istart ,            // First case in this batch, for random sampling hidden1 if not mean_field
    double sparse_pen ,     // Sparsity penalty
    double sparse_targ ,    // Sparsity target
    double *hid_bias ,      // Hidden bias vector, nhid long
@@ -1651,7 +1688,7 @@ int cuda_update_hid_bias (
    blocks_per_grid = (nhid + threads_per_block - 1) / threads_per_block ;
 
    device_update_hid_bias <<< blocks_per_grid , threads_per_block >>>
-              ( nc , (float) rate , (float) momentum , random_offset ,
+              ( nc , (float) rate , (float) momentum , istart ,
               (float) sparse_pen , (float) sparse_targ ) ;   
    cudaThreadSynchronize() ;
    error_id = cudaGetLastError () ;
@@ -0,0 +1,146 @@
+/******************************************************************************/
+/*                                                                            */
+/*  DATASRC.H - Training data that need not fit in memory as doubles          */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef DATASRC_H
+#define DATASRC_H
+
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+   Storage types.  Values are always delivered as doubles.
+   DATASRC_UINT8 holds 0-1 data (such as pixels) as 0-255.
+*/
+
+#define DATASRC_DOUBLE 0
+#define DATASRC_FLOAT  1
+#define DATASRC_UINT8  2
+
+/*
+   Cases per block.  A shuffled pass through a resident DataSource reads
+   every case in a new random order, as the trainers always did.  A mapped
+   file is instead read a block at a time, with the blocks in random order
+   and the cases within each block in random order, so that reads from the
+   file are long and sequential.  A batch then comes from only one or two
+   blocks, so a file should not be sorted by class or otherwise have
+   similar cases together.
+*/
+
+#define DATASRC_BLOCK 1024
+
+
+/*
+--------------------------------------------------------------------------------
+
+   DataSource - Cases (rows) of training data, either resident or in a
+                memory-mapped file written by DataSourceWriter
+
+   Random access:  get_case() converts one case.
+   Streaming:      start_pass(), then read() repeatedly until it returns
+                   fewer cases than requested, then end_pass().
+                   While the caller works on one block, a background thread
+                   converts the next one (paging it in from the file).
+
+   File layout: DATASRC_HEADER, then ncols doubles holding the mean of
+   each column, then nc rows of ncols values of the stored type.
+
+--------------------------------------------------------------------------------
+*/
+
+typedef struct {
+   char id[8] ;      // "DATASRC1"
+   int type ;        // DATASRC_?
+   int nc ;          // Number of cases
+   int ncols ;       // Number of columns in each case
+   int reserved ;    // Keeps the means aligned
+} DATASRC_HEADER ;
+
+class DataSource {
+
+public:
+   DataSource ( int nc , int ncols , double *data ) ;   // Resident; data is not copied
+   DataSource ( char *filename ) ;                      // Memory-mapped file
+   ~DataSource () ;
+
+   void get_case ( int icase , int ncols_used , double *dest ) ;
+   void column_means ( int ncols_used , double *mean ) ;
+
+   int start_pass ( int shuffle , int ncols_used ) ;
+   int read ( int n , double *dest , int *case_index ) ;
+   void end_pass () ;
+
+   int ok ;          // Did the constructor succeed?
+   int nc ;          // Number of cases
+   int ncols ;       // Number of columns in each case
+   int type ;        // DATASRC_?
+
+private:
+   void prefetch () ;
+   void unmap () ;
+
+   unsigned char *base ;      // First case
+   long long row_bytes ;      // Size of a case as stored
+   double *stored_means ;     // Column means from the file, or NULL if not yet known
+   void *map_addr ;           // Whole mapped file, NULL if resident
+   long long map_bytes ;      // Its size
+   void *map_handle ;         // Operating system's handles for the mapping
+   void *file_handle ;
+
+   // The current pass
+
+   int pass_number ;          // Counts passes, for random numbers
+   unsigned int pass_seed ;   // Random seed for shuffling within blocks
+   int shuffle ;              // Is this pass shuffled?
+   int ncols_used ;           // The first this many columns are delivered
+   int n_blocks ;             // Number of blocks in the dataset
+   int *block_order ;         // Order in which blocks are read this pass
+   int *case_order ;          // Order of all cases if resident and shuffled, else NULL
+   double *buf[2] ;           // Double buffer of converted blocks
+   int *buf_index[2] ;        // Index in dataset of each case in buf
+   int buf_n[2] ;             // Number of cases in buf
+   int buf_full[2] ;          // Has the prefetcher filled buf and the reader not finished it?
+   int blocks_read ;          // Blocks the reader has started
+   int cur_buf ;              // Buffer the reader is using, -1 if none
+   int cur_pos ;              // Next case in it
+   int quit ;                 // Tells the prefetcher to stop early
+   int started ;              // Is the prefetcher running?
+   std::thread prefetcher ;
+   std::mutex mtx ;           // Protects buf_n, buf_full, quit
+   std::condition_variable changed ;
+} ;
+
+
+/*
+--------------------------------------------------------------------------------
+
+   DataSourceWriter - Create a file for DataSource, a few cases at a time
+
+--------------------------------------------------------------------------------
+*/
+
+class DataSourceWriter {
+
+public:
+   DataSourceWriter ( char *filename , int type , int ncols ) ;
+   ~DataSourceWriter () ;
+
+   int append ( int n , double *data , int data_cols ) ;
+   int close () ;
+
+   int ok ;          // Did the constructor succeed?
+
+private:
+   FILE *fp ;
+   int type ;
+   int nc ;
+   int ncols ;
+   double *sums ;             // Column sums, for the means written by close()
+   unsigned char *row ;       // One case converted to the stored type
+} ;
+
+#endif
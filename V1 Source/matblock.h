@@ -0,0 +1,22 @@
+/******************************************************************************/
+/*                                                                            */
+/*  MATBLOCK.H - Cache-blocked, SIMD matrix kernels for the CPU engines       */
+/*                                                                            */
+/*  All matrices are row-major doubles with an explicit leading dimension     */
+/*  (the distance between the starts of consecutive rows).                    */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef MATBLOCK_H
+#define MATBLOCK_H
+
+extern void mat_mul_acc ( int m , int n , int k , double *a , int lda ,
+                          double *b , int ldb , double *c , int ldc ) ;
+extern void mat_tmul_acc ( int m , int n , int k , double alpha , double *a , int lda ,
+                           double *b , int ldb , double *c , int ldc ) ;
+extern void mat_transpose ( int rows , int cols , double *a , int lda , double *at , int ldat ) ;
+extern void exp_block ( int n , double *x ) ;
+extern void logistic_block ( int n , double *x ) ;
+extern void softmax_block ( int n , int m , double *x ) ;
+
+#endif
@@ -0,0 +1,123 @@
+/******************************************************************************/
+/*                                                                            */
+/*  PHILOX.H - Counter-based random numbers shared by the CPU and CUDA code   */
+/*                                                                            */
+/*  This is the Philox4x32-10 generator of Salmon et al. (2011).              */
+/*  Rather than stepping a state, each draw is a pure function of its key    */
+/*  and counter, so a random number can be produced for any                   */
+/*  (epoch, case, layer, unit) in any order, on any thread or device.         */
+/*  Results therefore do not depend on how cases are split among threads,     */
+/*  and the host and device engines draw exactly the same uniforms.           */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#if defined(__CUDACC__)
+#define PHILOX_FUNC __host__ __device__ __forceinline__
+#else
+#define PHILOX_FUNC inline
+#endif
+
+#define PHILOX_M0 0xD2511F53u   // Round multipliers
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u   // Key schedule increments (golden ratio, sqrt(3)-1)
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+/*
+   What a draw is for.  This goes in the counter along with the chain step,
+   so that every sampling step of a case gets its own independent stream.
+*/
+
+#define RNG_VIS1   0   // Sampling the training case (if not greedy_mean_field)
+#define RNG_HID    1   // Sampling hidden neurons in the Markov chain
+#define RNG_VIS2   2   // Sampling visible neurons in the Markov chain (if not mean_field)
+#define RNG_HID1   3   // Sampling hidden1 for the positive gradient term (if not mean_field)
+#define RNG_START  4   // Sampling a random starting layer for generation
+#define RNG_SHUFFLE 5  // Shuffling cases within a block of a DataSource
+#define RNG_PHASE(kind,ichain) ((kind) + 8 * (ichain))
+
+
+/*
+--------------------------------------------------------------------------------
+
+   philox4x32 - Four random 32-bit integers for a 128-bit counter and 64-bit key
+
+--------------------------------------------------------------------------------
+*/
+
+PHILOX_FUNC void philox4x32 (
+   unsigned int *ctr ,    // Input: the four counter words
+   unsigned int key0 ,    // First key word
+   unsigned int key1 ,    // Second key word
+   unsigned int *out      // Output: four random words
+   )
+{
+   int iround ;
+   unsigned int c0, c1, c2, c3 ;
+   unsigned long long p0, p1 ;
+
+   c0 = ctr[0] ;
+   c1 = ctr[1] ;
+   c2 = ctr[2] ;
+   c3 = ctr[3] ;
+
+   for (iround=0 ; iround<PHILOX_ROUNDS ; iround++) {
+      p0 = (unsigned long long) PHILOX_M0 * c0 ;
+      p1 = (unsigned long long) PHILOX_M1 * c2 ;
+      c0 = (unsigned int) (p1 >> 32) ^ c1 ^ key0 ;
+      c2 = (unsigned int) (p0 >> 32) ^ c3 ^ key1 ;
+      c1 = (unsigned int) p1 ;
+      c3 = (unsigned int) p0 ;
+      key0 += PHILOX_W0 ;
+      key1 += PHILOX_W1 ;
+      }
+
+   out[0] = c0 ;
+   out[1] = c1 ;
+   out[2] = c2 ;
+   out[3] = c3 ;
+}
+
+
+/*
+--------------------------------------------------------------------------------
+
+   rng_uniform - The uniform random number for one unit
+
+   The key is (seed, layer); the counter is (unit/4, case, epoch, phase),
+   and each counter supplies four consecutive units.
+   The result is a multiple of 2^-24 in [0,1), so it is exactly the same
+   whether it is used as a float on the device or a double on the host.
+
+--------------------------------------------------------------------------------
+*/
+
+PHILOX_FUNC float rng_uniform (
+   unsigned int seed ,    // Chosen once per training run or generation
+   int layer ,            // Layer of the model
+   int epoch ,            // Epoch, or any other outer counter
+   int icase ,            // Index of the case in the dataset
+   int phase ,            // RNG_PHASE ( kind , ichain )
+   int unit               // Neuron in the layer
+   )
+{
+   unsigned int ctr[4], out[4] ;
+
+   ctr[0] = (unsigned int) unit >> 2 ;
+   ctr[1] = (unsigned int) icase ;
+   ctr[2] = (unsigned int) epoch ;
+   ctr[3] = (unsigned int) phase ;
+   philox4x32 ( ctr , seed , (unsigned int) layer , out ) ;
+
+   return (float) (out[unit & 3] >> 8) * (1.0f / 16777216.0f) ;
+}
+
+#if ! defined(__CUDACC__)
+extern void rng_uniform_row ( unsigned int seed , int layer , int epoch , int icase ,
+                              int phase , int n , double *u ) ;
+#endif
+
+#endif
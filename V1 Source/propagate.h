@@ -0,0 +1,72 @@
+/******************************************************************************/
+/*                                                                            */
+/*  PROPAGATE.H - Batched propagation through the unsupervised stack          */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef PROPAGATE_H
+#define PROPAGATE_H
+
+#include "datasrc.h"
+
+#define PROP_MAX_NAME 256   // Longest cache file name prefix, including the layer suffix
+
+/*
+--------------------------------------------------------------------------------
+
+   Propagator - Moves many cases at once up or down through weights_unsup
+
+   A layer must be frozen (its weights final) before it is used.
+   Freezing makes a transposed copy of the weights, so the upward pass
+   is a single blocked matrix product for all of the cases.
+
+   up_stack() and down_stack() work on n cases at once, so that a batch
+   of inference or generation requests share one pass through the weights.
+
+   For greedy training, layer_data(i) is the DataSource of inputs to layer i.
+   Layer 0 is the caller's data.  Each higher layer's inputs (the hidden
+   probabilities of the frozen layer below) are computed the first time
+   they are requested, in one streaming pass over the layer below's cache,
+   and stored compactly in a file.  Thus no layer is ever computed twice,
+   and no nc by max_neurons matrix of doubles is ever held in memory.
+
+--------------------------------------------------------------------------------
+*/
+
+class Propagator {
+
+public:
+   Propagator ( int nvis , int max_neurons , int n_unsup , int *nhid_unsup ,
+                double **weights_unsup , double *in_bias , double *hid_bias ) ;
+   ~Propagator () ;
+
+   int freeze ( int ilayer ) ;
+   int n_in ( int ilayer ) ;
+   void up ( int ilayer , int n , double *vis , double *hid ) ;
+   void down ( int ilayer , int n , double *hid , double *vis ) ;
+   double *up_stack ( int ilayer , int n , double *x , double *work ) ;
+   double *down_stack ( int ilayer , int n , double *x , double *work ) ;
+
+   int set_data ( DataSource *data , char *cache_name , int cache_type ) ;
+   DataSource *layer_data ( int ilayer ) ;
+
+   int ok ;                         // Did the constructor succeed?
+
+private:
+   void discard ( int ilayer ) ;
+
+   int nvis ;                       // Number of inputs to the first (bottom) layer
+   int max_neurons ;                // Maximum number of neurons in any layer, as well as nvis
+   int n_unsup ;                    // Number of unsupervised layers
+   int *nhid_unsup ;                // Number of hidden neurons in each layer
+   double **weights_unsup ;         // Weight matrices, each being nhid sets of n_in weights
+   double *in_bias ;                // Input bias vectors; n_unsup sets of max_neurons each
+   double *hid_bias ;               // Hidden bias vectors; n_unsup sets of max_neurons each
+   double *wt[MAX_LAYERS] ;         // Transpose of each frozen layer's weights, else NULL
+   DataSource *data[MAX_LAYERS] ;   // Inputs to each layer, NULL until known
+   int cached[MAX_LAYERS] ;         // Did we create data[i] (so we delete it)?
+   int cache_type ;                 // DATASRC_? for cached activations
+   char cache_name[PROP_MAX_NAME] ; // Prefix of cache file names
+} ;
+
+#endif
@@ -0,0 +1,135 @@
+/******************************************************************************/
+/*                                                                            */
+/*  THRPOOL.H - Persistent, portable work-stealing thread pool                */
+/*                                                                            */
+/******************************************************************************/
+
+#ifndef THRPOOL_H
+#define THRPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+   Work is handed out in chunks of roughly this many per thread so that
+   stealing can balance uneven cases without a chunk being too tiny
+*/
+
+#define THRPOOL_CHUNKS_PER_THREAD 8
+
+/*
+   If nonzero, run_ordered() gives each slot a fixed run of chunks and
+   disables stealing, so sums cumulated per slot (and hence gradients)
+   are bitwise reproducible for a fixed thread count.
+   Set to zero to trade reproducibility for load balancing.
+*/
+
+#define THRPOOL_REPRODUCIBLE 1
+
+/*
+--------------------------------------------------------------------------------
+
+   CancelToken - Cooperative cancellation flag
+
+   Whoever detects the user's ESCape (the window procedure, or a signal
+   handler on other platforms) calls request().  Computation polls
+   requested() at convenient points and winds down cleanly.
+   The owner of the computation calls reset() once it has responded.
+
+--------------------------------------------------------------------------------
+*/
+
+class CancelToken {
+
+public:
+   CancelToken () : flag ( 0 ) {}
+
+   void request () { flag.store ( 1 ) ; }
+   void reset () { flag.store ( 0 ) ; }
+   int requested () const { return flag.load ( std::memory_order_relaxed ) ; }
+
+private:
+   std::atomic<int> flag ;
+} ;
+
+
+/*
+--------------------------------------------------------------------------------
+
+   ThreadPool - A fixed set of long-lived worker threads
+
+   run() splits the items [0,n_items) into chunks and calls
+   func ( user , istart , istop , islot ) for each chunk, where islot
+   (0 to n_threads-1) identifies the worker.  The caller can use islot
+   to address per-thread scratch memory, exactly as the old per-thread
+   parameter blocks did.  Each worker starts with a contiguous run of
+   chunks and steals from the tail of other workers when it runs dry.
+
+   run_ordered() is the same, except that (if THRPOOL_REPRODUCIBLE) no
+   stealing is done: slot i always processes the same chunks in order.
+   Use it when the func cumulates floating-point sums per slot.
+
+   Neither may be called from inside a func; the pool is not reentrant.
+
+--------------------------------------------------------------------------------
+*/
+
+typedef void (*THRPOOL_FUNC) ( void *user , int istart , int istop , int islot ) ;
+
+class ThreadPool {
+
+public:
+   ThreadPool ( int nthreads ) ;
+   ~ThreadPool () ;
+
+   int run ( int n_items , int chunk , THRPOOL_FUNC func , void *user , CancelToken *cancel ) ;
+   int run_ordered ( int n_items , int chunk , THRPOOL_FUNC func , void *user , CancelToken *cancel ) ;
+   int chunk_size ( int n_items ) ;
+
+   int ok ;          // Did the constructor succeed in starting all threads?
+   int n_threads ;   // Number of worker threads (slots)
+
+private:
+   int execute ( int n_items , int chunk , THRPOOL_FUNC func , void *user ,
+                 CancelToken *cancel , int steal ) ;
+   void worker ( int islot ) ;
+   void do_chunks ( int islot ) ;
+   int next_chunk ( int islot ) ;
+
+   struct WorkQueue {
+      std::mutex mtx ;
+      int lo ;       // Next chunk the owner will take
+      int hi ;       // One past the last chunk; thieves take from here
+      } ;
+
+   std::thread *threads ;
+   WorkQueue *queues ;
+   int n_started ;   // Threads actually running; less than n_threads only on failure
+
+   std::mutex mtx ;                // Protects everything below
+   std::condition_variable wake ;  // Workers wait here for a job
+   std::condition_variable done ;  // The caller waits here for completion
+   std::mutex run_mtx ;            // Serializes callers of run()
+   int generation ;  // Incremented for each job
+   int n_busy ;      // Workers still working on the current job
+   int quit ;        // Set by the destructor
+
+   // The current job; written by run() before waking the workers
+
+   int job_n_items ;
+   int job_chunk ;
+   THRPOOL_FUNC job_func ;
+   void *job_user ;
+   CancelToken *job_cancel ;
+   int job_steal ;
+   std::atomic<int> job_cancelled ;
+} ;
+
+extern CancelToken escape_token ;
+extern ThreadPool *get_thread_pool () ;
+extern void reduce_slots ( ThreadPool *pool , int n , double *base , long long stride ,
+                           int *used , double scale ) ;
+
+#endif